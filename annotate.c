@@ -0,0 +1,252 @@
+/*
+ * BULK GAME ANNOTATOR
+ *
+ * Usage: annotate <games file> <output file>
+ *
+ * The games file has one game per line, written as the positions (1-9) played
+ * in order, with X moving first, e.g. "5137". Every move is checked against
+ * perfect play with solve_position(), and the output file gets one mark per
+ * input byte, so that a mark lines up with the move it describes:
+ *
+ *   =   the move keeps the best result available to the player
+ *   ?   mistake, the move drops the result by one step (win to draw, draw to loss)
+ *   x   blunder, the move turns a won game into a lost one
+ *   -   not a legal move (taken cell, bad character, or the game was already over)
+ *
+ * Line endings are copied as they are.
+ *
+ * Both files are memory-mapped, and the input is cut into one chunk per core
+ * on line boundaries. As the output has the same size as the input, each
+ * thread writes straight into its own part of the output mapping, and the
+ * memory used does not grow with the size of the input.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pvc.h"
+#include "trace.h"
+
+// the work handed to each thread
+typedef struct
+{
+    const char* input;
+    char* output;
+    size_t start;
+    size_t end;
+    long records;
+} annotate_chunk;
+
+// outcome of a solve_position() score, 1 for a win, 0 for a draw and
+// -1 for a loss
+int get_outcome(int score)
+{
+    return (score > 0) - (score < 0);
+}
+
+char get_move_mark(uint32_t state, playables p, uint32_t played)
+{
+    int before = get_outcome(solve_position(state, p));
+    int after = -get_outcome(solve_position(played, get_next_playable(p)));
+
+    switch (before - after)
+    {
+        case 0:
+            return '=';
+        case 1:
+            return '?';
+        default:
+            return 'x';
+    }
+}
+
+void* annotate_worker(void* arg)
+{
+    annotate_chunk* chunk = arg;
+
+    TRACE_BEGIN("annotate_chunk");
+
+    uint32_t state = 0;
+    playables current = X;
+    int game_over = 0;
+    int line_started = 0;
+
+    for (size_t i = chunk->start; i < chunk->end; i++)
+    {
+        char c = chunk->input[i];
+
+        if (c == '\n' || c == '\r')
+        {
+            chunk->output[i] = c;
+            if (c == '\n')
+            {
+                // reset for the next game
+                chunk->records += line_started;
+                state = 0;
+                current = X;
+                game_over = 0;
+                line_started = 0;
+            }
+            continue;
+        }
+
+        line_started = 1;
+        int position = c - '0';
+
+        if (game_over || position < 1 || position > 9 || check_index(state, position))
+        {
+            // nothing after an illegal move can be scored
+            chunk->output[i] = '-';
+            game_over = 1;
+            continue;
+        }
+
+        uint32_t played = make_play(state, current, position);
+        chunk->output[i] = get_move_mark(state, current, played);
+
+        state = played;
+        game_over = check_win(state, current) || check_draw(state);
+        current = get_next_playable(current);
+    }
+
+    // last line without a trailing newline
+    chunk->records += line_started;
+
+    TRACE_END("annotate_chunk");
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        printf("Usage: %s <games file> <output file>\n", argv[0]);
+        return 1;
+    }
+
+    const char* trace_path = getenv("TTT_TRACE");
+    if (trace_path != NULL)
+    {
+        trace_enable();
+    }
+
+    int input_fd = open(argv[1], O_RDONLY);
+    if (input_fd < 0)
+    {
+        printf("Could not open %s!\n", argv[1]);
+        return 1;
+    }
+
+    struct stat input_stat;
+    fstat(input_fd, &input_stat);
+    size_t size = input_stat.st_size;
+
+    int output_fd = open(argv[2], O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (output_fd < 0 || ftruncate(output_fd, size) != 0)
+    {
+        printf("Could not create %s!\n", argv[2]);
+        return 1;
+    }
+
+    if (size == 0)
+    {
+        // nothing to annotate, and mmap refuses empty mappings
+        printf("0 records\n");
+        return 0;
+    }
+
+    const char* input = mmap(NULL, size, PROT_READ, MAP_PRIVATE, input_fd, 0);
+    char* output = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, output_fd, 0);
+    if (input == MAP_FAILED || output == MAP_FAILED)
+    {
+        printf("Could not map the files!\n");
+        return 1;
+    }
+    madvise((void*)input, size, MADV_SEQUENTIAL);
+    madvise(output, size, MADV_SEQUENTIAL);
+
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    // solving the empty board fills the whole solve cache, so the
+    // threads only ever read from it
+    TRACE_BEGIN("solve_cache");
+    solve_position(0, X);
+    TRACE_END("solve_cache");
+
+    long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count < 1)
+    {
+        thread_count = 1;
+    }
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * thread_count);
+    annotate_chunk* chunks = malloc(sizeof(annotate_chunk) * thread_count);
+    if (threads == NULL || chunks == NULL)
+    {
+        printf("\n Allocation Failed! Exiting.. \n");
+        exit(1);
+    }
+
+    // split the input into chunks that end on a line boundary
+    size_t chunk_start = 0;
+    for (long t = 0; t < thread_count; t++)
+    {
+        size_t chunk_end = size * (t + 1) / thread_count;
+        while (chunk_end < size && chunk_end > chunk_start && input[chunk_end - 1] != '\n')
+        {
+            chunk_end++;
+        }
+        if (chunk_end < chunk_start)
+        {
+            chunk_end = chunk_start;
+        }
+
+        chunks[t].input = input;
+        chunks[t].output = output;
+        chunks[t].start = chunk_start;
+        chunks[t].end = chunk_end;
+        chunks[t].records = 0;
+        pthread_create(&threads[t], NULL, annotate_worker, &chunks[t]);
+
+        chunk_start = chunk_end;
+    }
+
+    long records = 0;
+    for (long t = 0; t < thread_count; t++)
+    {
+        pthread_join(threads[t], NULL);
+        records += chunks[t].records;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+    printf(
+            "%ld records in %.3f s (%.0f records/s) on %ld threads\n",
+            records,
+            seconds,
+            seconds > 0 ? records / seconds : 0.0,
+            thread_count
+          );
+
+    munmap((void*)input, size);
+    munmap(output, size);
+    close(input_fd);
+    close(output_fd);
+    free(threads);
+    free(chunks);
+
+    if (trace_path != NULL)
+    {
+        trace_dump(trace_path);
+    }
+    return 0;
+}
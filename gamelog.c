@@ -0,0 +1,246 @@
+/*
+ * BINARY GAME LOG
+ *
+ * The writer packs records into its own buffer and only calls write() when
+ * the buffer is full (or on flush/close), so appending a game is a handful of
+ * stores. The file is opened with O_APPEND, so several sessions can keep
+ * adding to the same log. The header is written as soon as the log is opened
+ * on an empty file, under an flock() so two sessions opening a new log at the
+ * same time can't both decide to write it.
+ *
+ * The reader maps the whole file and hands out records that point into the
+ * mapping, so nothing is copied.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "gamelog.h"
+
+static const uint8_t gamelog_magic[4] = {'T', 'T', 'T', 'G'};
+
+static int write_all(int fd, const uint8_t* data, size_t size)
+{
+    // write() may stop short, keep going until everything is out
+    while (size > 0)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+        {
+            return -1;
+        }
+        data += written;
+        size -= written;
+    }
+    return 0;
+}
+
+gamelog_writer* gamelog_open_writer(const char* path, int with_result)
+{
+    /*
+     * Open <path> for appending, creating it if needed.
+     * Returns NULL if the file can't be opened, or if it already
+     * holds a log with a different header.
+     */
+    gamelog_writer* writer = malloc(sizeof(gamelog_writer));
+    if (writer == NULL)
+    {
+        return NULL;
+    }
+
+    writer->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    writer->with_result = with_result;
+    writer->used = 0;
+    if (writer->fd < 0)
+    {
+        free(writer);
+        return NULL;
+    }
+
+    // checking for and writing the header has to happen as one step
+    if (flock(writer->fd, LOCK_EX) != 0)
+    {
+        close(writer->fd);
+        free(writer);
+        return NULL;
+    }
+
+    uint8_t header[GAMELOG_HEADER_SIZE] = {0};
+    ssize_t header_size = pread(writer->fd, header, GAMELOG_HEADER_SIZE, 0);
+    int status = 0;
+
+    if (header_size == 0)
+    {
+        // new log, write the header out straight away
+        memcpy(header, gamelog_magic, 4);
+        header[4] = GAMELOG_VERSION;
+        header[5] = with_result ? GAMELOG_FLAG_RESULT : 0;
+        status = write_all(writer->fd, header, GAMELOG_HEADER_SIZE);
+    }
+    else if (header_size != GAMELOG_HEADER_SIZE
+            || memcmp(header, gamelog_magic, 4) != 0
+            || header[4] != GAMELOG_VERSION
+            || !(header[5] & GAMELOG_FLAG_RESULT) != !with_result)
+    {
+        status = -1;
+    }
+
+    flock(writer->fd, LOCK_UN);
+
+    if (status != 0)
+    {
+        close(writer->fd);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int gamelog_append(gamelog_writer* writer, const uint8_t* moves, int move_count, uint8_t result)
+{
+    /*
+     * Append a game of <move_count> moves (positions 1-9).
+     * <result> is ignored unless the log was opened with results.
+     * Returns 0 on success and -1 on errors.
+     */
+    if (move_count < 0 || move_count > 9)
+    {
+        return -1;
+    }
+
+    // largest possible record is 1 + 5 + 1 bytes
+    if (writer->used + 7 > GAMELOG_BUFFER_SIZE && gamelog_flush(writer) != 0)
+    {
+        return -1;
+    }
+
+    uint8_t* out = writer->buffer + writer->used;
+    *out++ = move_count;
+    for (int i = 0; i < move_count; i += 2)
+    {
+        uint8_t packed = moves[i] & 0x0F;
+        if (i + 1 < move_count)
+        {
+            packed |= (moves[i + 1] & 0x0F) << 4;
+        }
+        *out++ = packed;
+    }
+    if (writer->with_result)
+    {
+        *out++ = result;
+    }
+
+    writer->used = out - writer->buffer;
+    return 0;
+}
+
+int gamelog_flush(gamelog_writer* writer)
+{
+    // write out everything buffered so far
+    if (write_all(writer->fd, writer->buffer, writer->used) != 0)
+    {
+        return -1;
+    }
+    writer->used = 0;
+    return 0;
+}
+
+int gamelog_close_writer(gamelog_writer* writer)
+{
+    int status = gamelog_flush(writer);
+    if (close(writer->fd) != 0)
+    {
+        status = -1;
+    }
+    free(writer);
+    return status;
+}
+
+gamelog_reader* gamelog_open_reader(const char* path)
+{
+    /*
+     * Map the log at <path> for reading.
+     * Returns NULL if it can't be opened or isn't a game log.
+     */
+    gamelog_reader* reader = malloc(sizeof(gamelog_reader));
+    if (reader == NULL)
+    {
+        return NULL;
+    }
+
+    reader->fd = open(path, O_RDONLY);
+    struct stat log_stat;
+    if (reader->fd < 0 || fstat(reader->fd, &log_stat) != 0 || log_stat.st_size < GAMELOG_HEADER_SIZE)
+    {
+        if (reader->fd >= 0)
+        {
+            close(reader->fd);
+        }
+        free(reader);
+        return NULL;
+    }
+
+    reader->size = log_stat.st_size;
+    reader->data = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+    if (reader->data == MAP_FAILED
+            || memcmp(reader->data, gamelog_magic, 4) != 0
+            || reader->data[4] != GAMELOG_VERSION)
+    {
+        if (reader->data != MAP_FAILED)
+        {
+            munmap((void*)reader->data, reader->size);
+        }
+        close(reader->fd);
+        free(reader);
+        return NULL;
+    }
+    madvise((void*)reader->data, reader->size, MADV_SEQUENTIAL);
+
+    reader->with_result = reader->data[5] & GAMELOG_FLAG_RESULT;
+    reader->offset = GAMELOG_HEADER_SIZE;
+    return reader;
+}
+
+int gamelog_next(gamelog_reader* reader, gamelog_record* record)
+{
+    /*
+     * Read the next record into <record>.
+     * Returns 1 for a record, 0 at the end of the log and -1
+     * if the log is corrupt or cut short.
+     */
+    if (reader->offset >= reader->size)
+    {
+        return 0;
+    }
+
+    int move_count = reader->data[reader->offset];
+    size_t record_size = 1 + (move_count + 1) / 2 + (reader->with_result ? 1 : 0);
+    if (move_count > 9 || reader->offset + record_size > reader->size)
+    {
+        return -1;
+    }
+
+    record->move_count = move_count;
+    record->packed_moves = reader->data + reader->offset + 1;
+    record->result = reader->with_result ? reader->data[reader->offset + record_size - 1] : GAMELOG_UNFINISHED;
+
+    reader->offset += record_size;
+    return 1;
+}
+
+int gamelog_get_move(const gamelog_record* record, int index)
+{
+    // position (1-9) of move <index> in the record
+    return (record->packed_moves[index / 2] >> (4 * (index & 1))) & 0x0F;
+}
+
+void gamelog_close_reader(gamelog_reader* reader)
+{
+    munmap((void*)reader->data, reader->size);
+    close(reader->fd);
+    free(reader);
+}
@@ -0,0 +1,74 @@
+#ifndef GAMELOG_H
+#define GAMELOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Compact binary game log.
+ *
+ * FILE HEADER (8 bytes)
+ *   "TTTG", version, flags, 2 reserved bytes
+ *   flag GAMELOG_FLAG_RESULT means every record ends with a result byte
+ *
+ * RECORD
+ *   1 byte      number of moves n (0-9)
+ *   (n+1)/2     moves (positions 1-9), 4 bits each, first move in the low nibble
+ *   1 byte      result, only if the header has GAMELOG_FLAG_RESULT
+ *
+ * A full game is at most 7 bytes with the result byte (6 without), against
+ * 10 or more for a line of text.
+ */
+
+#define GAMELOG_VERSION 1
+#define GAMELOG_HEADER_SIZE 8
+#define GAMELOG_FLAG_RESULT 0x01
+
+// size of the writer buffer, records are only written out when it fills up
+#define GAMELOG_BUFFER_SIZE 65536
+
+// result byte, the outcome sits in the low 2 bits
+#define GAMELOG_UNFINISHED 0x00
+#define GAMELOG_X_WINS 0x01
+#define GAMELOG_O_WINS 0x02
+#define GAMELOG_DRAW 0x03
+#define GAMELOG_OUTCOME_MASK 0x03
+// set when O made the first move
+#define GAMELOG_O_FIRST 0x04
+
+typedef struct
+{
+    int fd;
+    int with_result;
+    size_t used;
+    uint8_t buffer[GAMELOG_BUFFER_SIZE];
+} gamelog_writer;
+
+typedef struct
+{
+    int fd;
+    int with_result;
+    const uint8_t* data;
+    size_t size;
+    size_t offset;
+} gamelog_reader;
+
+// one record, pointing straight into the reader's mapping
+typedef struct
+{
+    int move_count;
+    const uint8_t* packed_moves;
+    uint8_t result;
+} gamelog_record;
+
+gamelog_writer* gamelog_open_writer(const char* path, int with_result);
+int gamelog_append(gamelog_writer* writer, const uint8_t* moves, int move_count, uint8_t result);
+int gamelog_flush(gamelog_writer* writer);
+int gamelog_close_writer(gamelog_writer* writer);
+
+gamelog_reader* gamelog_open_reader(const char* path);
+int gamelog_next(gamelog_reader* reader, gamelog_record* record);
+int gamelog_get_move(const gamelog_record* record, int index);
+void gamelog_close_reader(gamelog_reader* reader);
+
+#endif
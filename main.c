@@ -1,15 +1,110 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // include the files for the player vs computer game
 #include "pvc.h"
 // include the files for the player vs player game
 #include "pvp.h"
+// optional timeline tracing
+#include "trace.h"
+// proof-number search on larger boards
+#include "pns.h"
+// random playouts
+#include "playout.h"
 
-int main()
+int main(int argc, char** argv)
 {
 
     int choice;
 
+    // set TTT_TRACE to a file name to record a trace of the session
+    const char* trace_path = getenv("TTT_TRACE");
+    if (trace_path != NULL)
+    {
+        trace_enable();
+    }
+
+    // ttt perft <depth> [moves] [split]
+    if (argc >= 3 && strcmp(argv[1], "perft") == 0)
+    {
+        const char* moves = "";
+        int split = 0;
+        for (int i = 3; i < argc; i++)
+        {
+            if (strcmp(argv[i], "split") == 0)
+            {
+                split = 1;
+            }
+            else
+            {
+                moves = argv[i];
+            }
+        }
+        int status = run_perft(atoi(argv[2]), moves, split);
+        if (trace_path != NULL)
+        {
+            trace_dump(trace_path);
+        }
+        return status;
+    }
+
+    // ttt pns <width> <height> <k> [moves|-] [node budget]
+    if (argc >= 5 && strcmp(argv[1], "pns") == 0)
+    {
+        const char* moves = (argc >= 6 && strcmp(argv[5], "-") != 0) ? argv[5] : "";
+        uint64_t budget = (argc >= 7) ? strtoull(argv[6], NULL, 10) : 100000000ull;
+        int status = run_pns(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), moves, budget);
+        if (trace_path != NULL)
+        {
+            trace_dump(trace_path);
+        }
+        return status;
+    }
+
+    // ttt playout [moves|-] [playouts]
+    if (argc >= 2 && strcmp(argv[1], "playout") == 0)
+    {
+        const char* moves = (argc >= 3 && strcmp(argv[2], "-") != 0) ? argv[2] : "";
+        int playouts = (argc >= 4) ? atoi(argv[3]) : 10000000;
+        int status = run_playouts(moves, playouts);
+        if (trace_path != NULL)
+        {
+            trace_dump(trace_path);
+        }
+        return status;
+    }
+
+    // set TTT_GAMELOG to a file name to append the game to a binary log
+    gamelog_writer* game_log = NULL;
+    const char* game_log_path = getenv("TTT_GAMELOG");
+    if (game_log_path != NULL)
+    {
+        game_log = gamelog_open_writer(game_log_path, 1);
+        if (game_log == NULL)
+        {
+            printf("Could not open the game log %s!\n", game_log_path);
+        }
+        set_pvc_game_log(game_log);
+    }
+
+    // set TTT_NNUE to a weights file to evaluate positions with a network
+    const char* nnue_path = getenv("TTT_NNUE");
+    if (nnue_path != NULL && nnue_load(nnue_path) != 0)
+    {
+        printf("Could not load the network %s!\n", nnue_path);
+    }
+
+    // set TTT_ENDGAME_EMPTIES to N to have the computer search to
+    // TTT_SEARCH_DEPTH plies (4 by default) and solve exactly once
+    // fewer than N cells are empty
+    const char* endgame_empties = getenv("TTT_ENDGAME_EMPTIES");
+    if (endgame_empties != NULL)
+    {
+        const char* search_depth = getenv("TTT_SEARCH_DEPTH");
+        set_pvc_hybrid_engine(atoi(endgame_empties), search_depth != NULL ? atoi(search_depth) : 4);
+    }
+
     // the menu goes here
     printf("Welcome to Tic Tac Toe!\n");
     printf("Press 1 to play against another person.\n");
@@ -29,4 +124,14 @@ int main()
             break;
     }
 
+    if (game_log != NULL)
+    {
+        gamelog_close_writer(game_log);
+    }
+
+    if (trace_path != NULL)
+    {
+        trace_dump(trace_path);
+    }
+
 }
@@ -0,0 +1,222 @@
+/*
+ * QUANTIZED NETWORK EVALUATOR
+ *
+ * The first layer only ever sees 0/1 inputs, so its output (the accumulator)
+ * is the bias plus one column of weights per stone on the board. Playing a
+ * move just adds one more column, so search_position() keeps an accumulator
+ * per ply and updates it as it goes instead of recomputing it at every leaf.
+ *
+ * The rest of the network is small integer arithmetic on the clipped
+ * accumulator. With AVX2 (build with -mavx2 or -march=native) every neuron of
+ * the inner layer is one 32-byte multiply-add; without it the same sums are
+ * done with plain loops.
+ *
+ * ------- WEIGHTS FILE
+ *
+ * "TTTN", then as little-endian 32-bit integers the version (1), the hidden
+ * size (32) and the inner layer size (32), then every array of nnue_network
+ * in order, little-endian with no padding.
+ *
+ * Scores come out from X's point of view, and nnue_evaluate() flips them
+ * for O.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "nnue.h"
+
+#define NNUE_VERSION 1
+
+nnue_network* nnue_active_network = NULL;
+
+static int read_array(FILE* in, void* data, size_t size)
+{
+    return fread(data, 1, size, in) == size ? 0 : -1;
+}
+
+int nnue_load(const char* path)
+{
+    /*
+     * Load the network at <path> and make it the active one.
+     * Returns 0 on success and -1 if the file can't be read or
+     * doesn't match the network compiled in.
+     */
+    FILE* in = fopen(path, "rb");
+    if (in == NULL)
+    {
+        return -1;
+    }
+
+    nnue_network* network = aligned_alloc(32, sizeof(nnue_network));
+    if (network == NULL)
+    {
+        fclose(in);
+        return -1;
+    }
+
+    char magic[4];
+    uint32_t header[3];
+    int status = read_array(in, magic, 4);
+    status |= read_array(in, header, sizeof(header));
+    if (status != 0 || memcmp(magic, "TTTN", 4) != 0 || header[0] != NNUE_VERSION
+            || header[1] != NNUE_HIDDEN || header[2] != NNUE_L1)
+    {
+        free(network);
+        fclose(in);
+        return -1;
+    }
+
+    status |= read_array(in, network->feature_weights, sizeof(network->feature_weights));
+    status |= read_array(in, network->feature_bias, sizeof(network->feature_bias));
+    status |= read_array(in, network->l1_weights, sizeof(network->l1_weights));
+    status |= read_array(in, network->l1_bias, sizeof(network->l1_bias));
+    status |= read_array(in, network->output_weights, sizeof(network->output_weights));
+    status |= read_array(in, &network->output_bias, sizeof(network->output_bias));
+    fclose(in);
+
+    if (status != 0)
+    {
+        free(network);
+        return -1;
+    }
+
+    free(nnue_active_network);
+    nnue_active_network = network;
+    return 0;
+}
+
+static int get_feature(int player, int position)
+{
+    // X's cells are features 0-8, O's are 9-17
+    return player * 9 + position - 1;
+}
+
+static void add_feature(nnue_accumulator* acc, int feature)
+{
+    const int16_t* column = nnue_active_network->feature_weights[feature];
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+    {
+        acc->values[i] += column[i];
+    }
+}
+
+void nnue_refresh(nnue_accumulator* acc, uint32_t state)
+{
+    // build the accumulator for <state> from scratch
+    memcpy(acc->values, nnue_active_network->feature_bias, sizeof(acc->values));
+
+    uint32_t x_board = (state >> 12) & 0x000001FF;
+    uint32_t o_board = state & 0x000001FF;
+    while (x_board)
+    {
+        // position 1 is the highest bit of the 9
+        add_feature(acc, get_feature(0, 9 - __builtin_ctz(x_board)));
+        x_board &= x_board - 1;
+    }
+    while (o_board)
+    {
+        add_feature(acc, get_feature(1, 9 - __builtin_ctz(o_board)));
+        o_board &= o_board - 1;
+    }
+}
+
+void nnue_add_move(const nnue_accumulator* parent, nnue_accumulator* child, int player, int position)
+{
+    // accumulator after <player> (0 for X, 1 for O) plays at <position>
+    *child = *parent;
+    add_feature(child, get_feature(player, position));
+}
+
+#ifdef __AVX2__
+
+static int32_t sum_epi32(__m256i v)
+{
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+static int32_t propagate(const nnue_network* network, const nnue_accumulator* acc)
+{
+    // clip the accumulator to 0-127 bytes, packus keeps the lanes of each
+    // 128-bit half apart so the bytes have to be put back in order
+    __m256i low = _mm256_load_si256((const __m256i*)&acc->values[0]);
+    __m256i high = _mm256_load_si256((const __m256i*)&acc->values[16]);
+    __m256i packed = _mm256_packus_epi16(low, high);
+    packed = _mm256_min_epu8(packed, _mm256_set1_epi8(NNUE_ACTIVATION_MAX));
+    __m256i input = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+
+    const __m256i ones = _mm256_set1_epi16(1);
+    uint8_t hidden[NNUE_L1] __attribute__((aligned(32)));
+
+    for (int j = 0; j < NNUE_L1; j++)
+    {
+        __m256i weights = _mm256_load_si256((const __m256i*)network->l1_weights[j]);
+        // u8 x i8 into pairs of i16, then pairs of those into i32
+        __m256i products = _mm256_madd_epi16(_mm256_maddubs_epi16(input, weights), ones);
+        int32_t sum = (sum_epi32(products) + network->l1_bias[j]) >> NNUE_L1_SHIFT;
+        hidden[j] = sum < 0 ? 0 : (sum > NNUE_ACTIVATION_MAX ? NNUE_ACTIVATION_MAX : sum);
+    }
+
+    __m256i hidden_vector = _mm256_load_si256((const __m256i*)hidden);
+    __m256i output_weights = _mm256_load_si256((const __m256i*)network->output_weights);
+    __m256i products = _mm256_madd_epi16(_mm256_maddubs_epi16(hidden_vector, output_weights), ones);
+    return sum_epi32(products) + network->output_bias;
+}
+
+#else
+
+static int32_t propagate(const nnue_network* network, const nnue_accumulator* acc)
+{
+    uint8_t input[NNUE_HIDDEN];
+    for (int i = 0; i < NNUE_HIDDEN; i++)
+    {
+        int16_t value = acc->values[i];
+        input[i] = value < 0 ? 0 : (value > NNUE_ACTIVATION_MAX ? NNUE_ACTIVATION_MAX : value);
+    }
+
+    uint8_t hidden[NNUE_L1];
+    for (int j = 0; j < NNUE_L1; j++)
+    {
+        int32_t sum = 0;
+        for (int i = 0; i < NNUE_HIDDEN; i++)
+        {
+            sum += input[i] * network->l1_weights[j][i];
+        }
+        sum = (sum + network->l1_bias[j]) >> NNUE_L1_SHIFT;
+        hidden[j] = sum < 0 ? 0 : (sum > NNUE_ACTIVATION_MAX ? NNUE_ACTIVATION_MAX : sum);
+    }
+
+    int32_t output = network->output_bias;
+    for (int j = 0; j < NNUE_L1; j++)
+    {
+        output += hidden[j] * network->output_weights[j];
+    }
+    return output;
+}
+
+#endif
+
+int nnue_evaluate(const nnue_accumulator* acc, int player, int limit)
+{
+    /*
+     * Score of the position for <player> (0 for X, 1 for O), clamped to
+     * -<limit>..<limit>. The search passes a limit below its won and lost
+     * scores, so no estimate can outrank a forced result.
+     */
+    int score = propagate(nnue_active_network, acc) / NNUE_OUTPUT_SCALE;
+    if (score > limit)
+    {
+        score = limit;
+    }
+    else if (score < -limit)
+    {
+        score = -limit;
+    }
+    return player == 0 ? score : -score;
+}
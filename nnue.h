@@ -0,0 +1,52 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <stdint.h>
+
+/*
+ * Small quantized network evaluator, used by search_position() in place of
+ * evaluate() once a network has been loaded.
+ *
+ * 18 inputs (a cell for each player) -> 32 (int16 accumulator) -> 32 (int8)
+ * -> 1, with clipped ReLU between the layers.
+ */
+
+#define NNUE_INPUTS 18
+#define NNUE_HIDDEN 32
+#define NNUE_L1 32
+
+// hidden activations are clipped to 0-127, which stands for 0.0-1.0
+#define NNUE_ACTIVATION_MAX 127
+// the first inner layer's sums are shifted down by this to get back to 0-127
+#define NNUE_L1_SHIFT 6
+// the output is divided by this to bring it in line with evaluate() scores
+#define NNUE_OUTPUT_SCALE 16
+
+typedef struct
+{
+    // first layer, the accumulator starts at the bias and gets a column
+    // of weights added for every stone on the board
+    int16_t feature_weights[NNUE_INPUTS][NNUE_HIDDEN] __attribute__((aligned(32)));
+    int16_t feature_bias[NNUE_HIDDEN] __attribute__((aligned(32)));
+
+    int8_t l1_weights[NNUE_L1][NNUE_HIDDEN] __attribute__((aligned(32)));
+    int32_t l1_bias[NNUE_L1];
+
+    int8_t output_weights[NNUE_L1] __attribute__((aligned(32)));
+    int32_t output_bias;
+} nnue_network;
+
+typedef struct
+{
+    int16_t values[NNUE_HIDDEN] __attribute__((aligned(32)));
+} nnue_accumulator;
+
+// the network loaded by nnue_load(), NULL if there is none
+extern nnue_network* nnue_active_network;
+
+int nnue_load(const char* path);
+void nnue_refresh(nnue_accumulator* acc, uint32_t state);
+void nnue_add_move(const nnue_accumulator* parent, nnue_accumulator* child, int player, int position);
+int nnue_evaluate(const nnue_accumulator* acc, int player, int limit);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * NETWORK WEIGHTS GENERATOR
+ *
+ * Usage: nnue_gen <output file>
+ *
+ * Writes a network in the format nnue_load() reads (see nnue.c), so the
+ * network evaluator can be run without a trained weights file. Instead of
+ * trained weights it gets hand-set ones that count open lines the same way
+ * evaluate() does:
+ *
+ *   hidden unit  side * 8 + line   is 32 for every stone <side> has on the
+ *                                  line, and is pushed below zero (clipped to
+ *                                  0) by any stone of the other side
+ *   inner neuron 2 * unit          is half of that unit, so 16 per stone
+ *   inner neuron 2 * unit + 1      is 24 when the line has two stones, 0 with one
+ *
+ * The output adds up the inner neurons, positive for X and negative for O,
+ * so that after dividing by NNUE_OUTPUT_SCALE an open line is worth 1 with
+ * one stone and 8 with two, the default EVAL_OPEN_ONE and EVAL_OPEN_TWO.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "pvc.h"
+#include "nnue.h"
+
+// stone weight in the hidden units, and what a stone of the other side takes off
+#define GEN_STONE 32
+#define GEN_BLOCK (-NNUE_ACTIVATION_MAX)
+
+// the second inner neuron of a line only fires above one stone's worth
+#define GEN_TWO_THRESHOLD 40
+
+void build_network(nnue_network* network)
+{
+    memset(network, 0, sizeof(nnue_network));
+
+    for (int side = 0; side < 2; side++)
+    {
+        for (int line = 0; line < 8; line++)
+        {
+            int unit = side * 8 + line;
+
+            for (int position = 1; position <= 9; position++)
+            {
+                // the O masks have position 1 at bit 8
+                if (!(win_bitmasks[1][line] & (1 << (9 - position))))
+                {
+                    continue;
+                }
+                network->feature_weights[side * 9 + position - 1][unit] = GEN_STONE;
+                network->feature_weights[(1 - side) * 9 + position - 1][unit] = GEN_BLOCK;
+            }
+
+            // (unit * 32) >> NNUE_L1_SHIFT is half the unit
+            network->l1_weights[2 * unit][unit] = 32;
+
+            // (unit - GEN_TWO_THRESHOLD) once shifted back down
+            network->l1_weights[2 * unit + 1][unit] = 1 << NNUE_L1_SHIFT;
+            network->l1_bias[2 * unit + 1] = -(GEN_TWO_THRESHOLD << NNUE_L1_SHIFT);
+
+            // one stone: 16 * 1 = 16, two stones: 32 * 1 + 24 * 4 = 128
+            int sign = side == 0 ? 1 : -1;
+            network->output_weights[2 * unit] = sign;
+            network->output_weights[2 * unit + 1] = sign * 4;
+        }
+    }
+}
+
+int write_network(const char* path, const nnue_network* network)
+{
+    FILE* out = fopen(path, "wb");
+    if (out == NULL)
+    {
+        return -1;
+    }
+
+    // fields are written as they are, so this assumes a little-endian host
+    uint32_t header[3] = {1, NNUE_HIDDEN, NNUE_L1};
+    size_t written = fwrite("TTTN", 1, 4, out);
+    written += fwrite(header, 1, sizeof(header), out);
+    written += fwrite(network->feature_weights, 1, sizeof(network->feature_weights), out);
+    written += fwrite(network->feature_bias, 1, sizeof(network->feature_bias), out);
+    written += fwrite(network->l1_weights, 1, sizeof(network->l1_weights), out);
+    written += fwrite(network->l1_bias, 1, sizeof(network->l1_bias), out);
+    written += fwrite(network->output_weights, 1, sizeof(network->output_weights), out);
+    written += fwrite(&network->output_bias, 1, sizeof(network->output_bias), out);
+
+    size_t expected = 4 + sizeof(header) + sizeof(network->feature_weights)
+        + sizeof(network->feature_bias) + sizeof(network->l1_weights)
+        + sizeof(network->l1_bias) + sizeof(network->output_weights)
+        + sizeof(network->output_bias);
+
+    if (fclose(out) != 0 || written != expected)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s <output file>\n", argv[0]);
+        return 1;
+    }
+
+    static nnue_network network;
+    build_network(&network);
+
+    if (write_network(argv[1], &network) != 0)
+    {
+        printf("Could not write %s!\n", argv[1]);
+        return 1;
+    }
+
+    // read it back the way the game will
+    if (nnue_load(argv[1]) != 0)
+    {
+        printf("Could not load %s back!\n", argv[1]);
+        return 1;
+    }
+
+    printf("Wrote %s\n", argv[1]);
+    return 0;
+}
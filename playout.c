@@ -0,0 +1,288 @@
+/*
+ * RANDOM PLAYOUTS
+ *
+ * playout_positions() plays random games to the end from each position and
+ * counts the outcomes. Games from the same position are played PLAYOUT_LANES
+ * at a time, one per 32-bit lane, with each lane holding its own copy of the
+ * X and O bitboards (the 9-bit halves of the uint32_t state).
+ *
+ * Every game in a batch starts from the same position, so on every ply the
+ * same player moves in all of the lanes and every lane still playing has the
+ * same number of empty cells, k. Each ply then comes down to:
+ *
+ * 1. draw a random number below k in every lane (xorshift32, then a multiply)
+ * 2. look up the r-th empty cell in select_table, indexed by the empty mask
+ *    and r, which is a gather
+ * 3. add it to the mover's bitboard, and AND it with the 8 win masks
+ *
+ * Lanes whose game is over are masked out and keep their result. With AVX2
+ * (build with -mavx2 or -march=native) each step is a single instruction or
+ * two across all the lanes; without it the same steps run as plain loops
+ * over the lanes.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "playout.h"
+#include "trace.h"
+
+// lane results
+#define PLAYOUT_DRAW 0
+#define PLAYOUT_X_WINS 1
+#define PLAYOUT_O_WINS 2
+
+// select_table[(empty << 4) | r] is the bit of the r-th empty cell of the
+// 9-bit <empty> mask, and 0 when there are no more than r empty cells
+static uint32_t select_table[512 << 4];
+static pthread_once_t select_table_once = PTHREAD_ONCE_INIT;
+
+static void init_select_table()
+{
+    for (uint32_t empty = 0; empty < 512; empty++)
+    {
+        uint32_t remaining = empty;
+        for (int r = 0; r < 16; r++)
+        {
+            select_table[(empty << 4) | r] = remaining & -remaining;
+            remaining &= remaining - 1;
+        }
+    }
+}
+
+#ifdef __AVX2__
+
+static void play_batch(uint32_t x_board, uint32_t o_board, int to_move, uint32_t rng[PLAYOUT_LANES],
+        uint32_t results[PLAYOUT_LANES])
+{
+    __m256i boards[2] = {_mm256_set1_epi32(x_board), _mm256_set1_epi32(o_board)};
+    __m256i state = _mm256_loadu_si256((const __m256i*)rng);
+    __m256i done = _mm256_setzero_si256();
+    __m256i winner = _mm256_setzero_si256();
+    const __m256i board_mask = _mm256_set1_epi32(0x000001FF);
+
+    int side = to_move;
+    int empty_count = 9 - __builtin_popcount(x_board | o_board);
+
+    for (int k = empty_count; k > 0; k--)
+    {
+        // xorshift32, then the top 16 bits scaled down to 0..k-1
+        state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 13));
+        state = _mm256_xor_si256(state, _mm256_srli_epi32(state, 17));
+        state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 5));
+        __m256i r = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(state, 16), _mm256_set1_epi32(k)), 16);
+
+        __m256i empty = _mm256_andnot_si256(_mm256_or_si256(boards[0], boards[1]), board_mask);
+        __m256i index = _mm256_or_si256(_mm256_slli_epi32(empty, 4), r);
+        __m256i bit = _mm256_i32gather_epi32((const int*)select_table, index, 4);
+
+        // finished games don't move any more
+        bit = _mm256_andnot_si256(done, bit);
+        boards[side] = _mm256_or_si256(boards[side], bit);
+
+        __m256i won = _mm256_setzero_si256();
+        for (int i = 0; i < 8; i++)
+        {
+            __m256i line = _mm256_set1_epi32(win_bitmasks[1][i]);
+            won = _mm256_or_si256(won, _mm256_cmpeq_epi32(_mm256_and_si256(boards[side], line), line));
+        }
+        won = _mm256_andnot_si256(done, won);
+        winner = _mm256_or_si256(winner, _mm256_and_si256(won, _mm256_set1_epi32(side + 1)));
+        done = _mm256_or_si256(done, won);
+
+        if (_mm256_movemask_epi8(done) == -1)
+        {
+            break;
+        }
+        side = !side;
+    }
+
+    _mm256_storeu_si256((__m256i*)rng, state);
+    _mm256_storeu_si256((__m256i*)results, winner);
+}
+
+#else
+
+static void play_batch(uint32_t x_board, uint32_t o_board, int to_move, uint32_t rng[PLAYOUT_LANES],
+        uint32_t results[PLAYOUT_LANES])
+{
+    uint32_t boards[2][PLAYOUT_LANES];
+    uint32_t done[PLAYOUT_LANES];
+
+    for (int lane = 0; lane < PLAYOUT_LANES; lane++)
+    {
+        boards[0][lane] = x_board;
+        boards[1][lane] = o_board;
+        done[lane] = 0;
+        results[lane] = PLAYOUT_DRAW;
+    }
+
+    int side = to_move;
+    int empty_count = 9 - __builtin_popcount(x_board | o_board);
+
+    for (int k = empty_count; k > 0; k--)
+    {
+        int playing = 0;
+        for (int lane = 0; lane < PLAYOUT_LANES; lane++)
+        {
+            uint32_t state = rng[lane];
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            rng[lane] = state;
+            uint32_t r = ((state >> 16) * k) >> 16;
+
+            uint32_t empty = ~(boards[0][lane] | boards[1][lane]) & 0x000001FF;
+            uint32_t bit = select_table[(empty << 4) | r] & ~done[lane];
+            boards[side][lane] |= bit;
+
+            uint32_t won = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                won |= (boards[side][lane] & win_bitmasks[1][i]) == win_bitmasks[1][i];
+            }
+            won = won ? ~done[lane] : 0;
+            results[lane] |= won & (side + 1);
+            done[lane] |= won;
+            playing |= !done[lane];
+        }
+
+        if (!playing)
+        {
+            break;
+        }
+        side = !side;
+    }
+}
+
+#endif
+
+static uint32_t seed_lane(uint64_t* seed)
+{
+    // splitmix64 to spread the seed over the lanes, never 0 for xorshift
+    uint64_t z = (*seed += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    uint32_t lane_seed = (z ^ (z >> 31)) >> 32;
+    return lane_seed ? lane_seed : 1;
+}
+
+void playout_positions(const uint32_t* states, const playables* to_move, int position_count,
+        int playouts, uint64_t seed, playout_counts* results)
+{
+    /*
+     * Play <playouts> random games from each of <states>, with
+     * <to_move> to play, and count the wins, draws and losses of
+     * the player to move into <results>.
+     */
+    pthread_once(&select_table_once, init_select_table);
+
+    uint32_t rng[PLAYOUT_LANES];
+    for (int lane = 0; lane < PLAYOUT_LANES; lane++)
+    {
+        rng[lane] = seed_lane(&seed);
+    }
+
+    for (int p = 0; p < position_count; p++)
+    {
+        uint32_t state = states[p];
+        int mover = get_index_from_playable(to_move[p]);
+        playout_counts* counts = &results[p];
+        counts->wins = 0;
+        counts->draws = 0;
+        counts->losses = 0;
+
+        // games that are already over
+        if (check_win(state, get_next_playable(to_move[p])))
+        {
+            counts->losses = playouts;
+            continue;
+        }
+        else if (check_win(state, to_move[p]))
+        {
+            counts->wins = playouts;
+            continue;
+        }
+
+        uint32_t x_board = (state >> 12) & 0x000001FF;
+        uint32_t o_board = state & 0x000001FF;
+        uint32_t lane_results[PLAYOUT_LANES];
+
+        for (int played = 0; played < playouts; played += PLAYOUT_LANES)
+        {
+            play_batch(x_board, o_board, mover, rng, lane_results);
+
+            // the last batch may only need some of its lanes
+            int lanes = playouts - played < PLAYOUT_LANES ? playouts - played : PLAYOUT_LANES;
+            for (int lane = 0; lane < lanes; lane++)
+            {
+                if (lane_results[lane] == PLAYOUT_DRAW)
+                {
+                    counts->draws++;
+                }
+                else if (lane_results[lane] == (uint32_t)mover + 1)
+                {
+                    counts->wins++;
+                }
+                else
+                {
+                    counts->losses++;
+                }
+            }
+        }
+    }
+}
+
+int run_playouts(const char* moves, int playouts)
+{
+    /*
+     * Play <playouts> random games from the position reached by
+     * playing <moves> (positions 1-9, X first), and print the
+     * outcomes and playouts per second.
+     * Returns 0 on success, and 1 for a bad position.
+     */
+    uint32_t state = 0;
+    playables current = X;
+
+    for (const char* c = moves; *c; c++)
+    {
+        int position = *c - '0';
+        if (position < 1 || position > 9 || check_index(state, position)
+                || heuristic(state, current) != 2)
+        {
+            printf("Invalid move sequence %s!\n", moves);
+            return 1;
+        }
+        state = make_play(state, current, position);
+        current = get_next_playable(current);
+    }
+
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    TRACE_BEGIN("playouts");
+
+    playout_counts counts;
+    playout_positions(&state, &current, 1, playouts, (uint64_t)begin.tv_nsec, &counts);
+
+    TRACE_END("playouts");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+    printf(
+            "%s to move: %llu wins, %llu draws, %llu losses\n",
+            get_string_for_playable(current),
+            (unsigned long long)counts.wins,
+            (unsigned long long)counts.draws,
+            (unsigned long long)counts.losses
+          );
+    printf(
+            "%d playouts in %.3f s (%.0f playouts/s)\n",
+            playouts,
+            seconds,
+            seconds > 0 ? playouts / seconds : 0.0
+          );
+    return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef PLAYOUT_H
+#define PLAYOUT_H
+
+#include <stdint.h>
+#include "pvc.h"
+
+// number of games played side by side, one per 32-bit SIMD lane
+#define PLAYOUT_LANES 8
+
+// outcomes of the playouts from one position, for the player to move
+typedef struct
+{
+    uint64_t wins;
+    uint64_t draws;
+    uint64_t losses;
+} playout_counts;
+
+void playout_positions(const uint32_t* states, const playables* to_move, int position_count,
+        int playouts, uint64_t seed, playout_counts* results);
+int run_playouts(const char* moves, int playouts);
+
+#endif
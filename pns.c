@@ -0,0 +1,487 @@
+/*
+ * PROOF-NUMBER SEARCH
+ *
+ * Minimax spreads its effort evenly over the tree, which is hopeless on large
+ * boards. Proof-number search instead keeps, for every node, the number of
+ * leaves that still have to be proven (pn) or disproven (dn) to settle the
+ * question "can the attacker force a win from here?", and always expands the
+ * node that is cheapest to settle. Narrow forcing lines get proven without
+ * ever looking at most of the tree.
+ *
+ * At an OR node (attacker to move) one winning child is enough:
+ *   pn = min(child pn), dn = sum(child dn)
+ * At an AND node (defender to move) every child has to be a win:
+ *   pn = sum(child pn), dn = min(child dn)
+ *
+ * This is the depth-first variant (df-pn). Rather than keeping the tree in
+ * memory, each node is searched with a pair of thresholds and only returns to
+ * its parent once its pn or dn goes over them. The numbers of the nodes seen
+ * so far live in a fixed-size transposition table, so memory use is bounded
+ * whatever the size of the search; an entry that gets overwritten just has to
+ * be searched again. Every position can go in one of two slots, and the slot
+ * that took less work to fill is the one replaced.
+ *
+ * A draw counts as a failure for the attacker, so proving the value of a
+ * position takes up to two searches: one with each player as the attacker.
+ *
+ * ------- BITBOARDS
+ *
+ * Like the uint32_t state in pvc.c, every line is a bitmask and a player has
+ * won when its stones ANDed with the mask give back the mask. As stones are
+ * only ever added, only the lines through the last cell played need checking.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pns.h"
+#include "trace.h"
+
+// a proof or disproof number that can't be reached, the node is settled
+#define PNS_INFINITY 0x3FFFFFFF
+
+typedef struct
+{
+    uint64_t stones[2];
+    uint32_t pn;
+    uint32_t dn;
+
+    // nodes searched to get these numbers, decides what gets replaced
+    uint32_t work;
+
+    uint8_t to_move;
+    uint8_t used;
+} pns_entry;
+
+struct pns_solver_t
+{
+    const mnk_board* board;
+
+    pns_entry* table;
+    uint64_t table_mask;
+
+    int attacker;
+    uint64_t nodes;
+    uint64_t node_budget;
+};
+
+/*
+ * BOARD METHODS
+ */
+
+int mnk_board_init(mnk_board* board, int width, int height, int k)
+{
+    /*
+     * Build the line masks for a <width> x <height> board where <k>
+     * in a row wins.
+     * Returns 0 on success and -1 if the board isn't supported.
+     */
+    if (width < 1 || height < 1 || width * height > PNS_MAX_CELLS
+            || k < 1 || k > 8 || (k > width && k > height))
+    {
+        return -1;
+    }
+
+    board->width = width;
+    board->height = height;
+    board->k = k;
+    board->cell_count = width * height;
+    board->line_count = 0;
+    memset(board->cell_line_count, 0, sizeof(board->cell_line_count));
+
+    // right, down, down-right and down-left
+    const int directions[4][2] = {{1, 0}, {0, 1}, {1, 1}, {-1, 1}};
+
+    for (int row = 0; row < height; row++)
+    {
+        for (int col = 0; col < width; col++)
+        {
+            for (int d = 0; d < 4; d++)
+            {
+                int end_col = col + directions[d][0] * (k - 1);
+                int end_row = row + directions[d][1] * (k - 1);
+                if (end_col < 0 || end_col >= width || end_row >= height)
+                {
+                    continue;
+                }
+                // a 1-in-a-row line is the same in every direction
+                if (k == 1 && d > 0)
+                {
+                    continue;
+                }
+
+                uint64_t mask = 0;
+                for (int i = 0; i < k; i++)
+                {
+                    int cell = (row + directions[d][1] * i) * width + col + directions[d][0] * i;
+                    mask |= 1ull << cell;
+                    board->cell_lines[cell][board->cell_line_count[cell]++] = board->line_count;
+                }
+                board->line_masks[board->line_count++] = mask;
+            }
+        }
+    }
+    return 0;
+}
+
+int mnk_check_win(const mnk_board* board, uint64_t stones, int cell)
+{
+    // check if the stones complete a line through <cell>
+    for (int i = 0; i < board->cell_line_count[cell]; i++)
+    {
+        uint64_t mask = board->line_masks[board->cell_lines[cell][i]];
+        if ((stones & mask) == mask)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * TRANSPOSITION TABLE
+ */
+
+pns_solver* pns_create(const mnk_board* board, int table_bits)
+{
+    // create a solver with a table of 2^<table_bits> entries
+    pns_solver* solver = malloc(sizeof(pns_solver));
+    if (solver == NULL)
+    {
+        return NULL;
+    }
+    solver->board = board;
+    solver->table_mask = (1ull << table_bits) - 1;
+    solver->table = calloc(solver->table_mask + 1, sizeof(pns_entry));
+    if (solver->table == NULL)
+    {
+        free(solver);
+        return NULL;
+    }
+    solver->attacker = 0;
+    solver->nodes = 0;
+    solver->node_budget = 0;
+    return solver;
+}
+
+void pns_destroy(pns_solver* solver)
+{
+    free(solver->table);
+    free(solver);
+}
+
+uint64_t pns_get_nodes(const pns_solver* solver)
+{
+    return solver->nodes;
+}
+
+static pns_entry* get_bucket(pns_solver* solver, const uint64_t stones[2], int to_move)
+{
+    // mix both bitboards down to the first of the two slots
+    uint64_t hash = stones[0] * 0x9E3779B97F4A7C15ull ^ stones[1] * 0xC2B2AE3D27D4EB4Full ^ to_move;
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ull;
+    hash ^= hash >> 32;
+    return &solver->table[hash & solver->table_mask & ~1ull];
+}
+
+static int entry_matches(const pns_entry* entry, const uint64_t stones[2], int to_move)
+{
+    return entry->used && entry->stones[0] == stones[0] && entry->stones[1] == stones[1]
+        && entry->to_move == to_move;
+}
+
+static void lookup(pns_solver* solver, const uint64_t stones[2], int to_move, uint32_t* pn, uint32_t* dn)
+{
+    // numbers of a position, 1/1 for a leaf that hasn't been seen yet
+    pns_entry* bucket = get_bucket(solver, stones, to_move);
+    for (int i = 0; i < 2; i++)
+    {
+        if (entry_matches(&bucket[i], stones, to_move))
+        {
+            *pn = bucket[i].pn;
+            *dn = bucket[i].dn;
+            return;
+        }
+    }
+    *pn = 1;
+    *dn = 1;
+}
+
+static void store(pns_solver* solver, const uint64_t stones[2], int to_move, uint32_t pn, uint32_t dn, uint32_t work)
+{
+    pns_entry* bucket = get_bucket(solver, stones, to_move);
+    pns_entry* entry;
+    if (entry_matches(&bucket[0], stones, to_move))
+    {
+        entry = &bucket[0];
+    }
+    else if (entry_matches(&bucket[1], stones, to_move))
+    {
+        entry = &bucket[1];
+    }
+    else
+    {
+        entry = (bucket[0].work <= bucket[1].work) ? &bucket[0] : &bucket[1];
+    }
+    entry->stones[0] = stones[0];
+    entry->stones[1] = stones[1];
+    entry->to_move = to_move;
+    entry->used = 1;
+    entry->pn = pn;
+    entry->dn = dn;
+    entry->work = work;
+}
+
+static uint32_t add_numbers(uint32_t a, uint32_t b)
+{
+    // saturating sum, so infinity stays infinity
+    uint32_t sum = a + b;
+    return sum > PNS_INFINITY ? PNS_INFINITY : sum;
+}
+
+/*
+ * DF-PN
+ */
+
+static void evaluate_child(pns_solver* solver, const uint64_t child[2], int mover, int cell, uint32_t* pn, uint32_t* dn)
+{
+    // numbers of the position after <mover> played at <cell>
+    uint64_t occupied = child[0] | child[1];
+
+    if (mnk_check_win(solver->board, child[mover], cell))
+    {
+        *pn = (mover == solver->attacker) ? 0 : PNS_INFINITY;
+        *dn = (mover == solver->attacker) ? PNS_INFINITY : 0;
+    }
+    else if (__builtin_popcountll(occupied) == solver->board->cell_count)
+    {
+        // a draw is a failure for the attacker
+        *pn = PNS_INFINITY;
+        *dn = 0;
+    }
+    else
+    {
+        lookup(solver, child, !mover, pn, dn);
+    }
+}
+
+static void multiple_iterative_deepening(pns_solver* solver, const uint64_t stones[2], int to_move,
+        uint32_t pn_threshold, uint32_t dn_threshold)
+{
+    int is_or_node = (to_move == solver->attacker);
+    int cell_count = solver->board->cell_count;
+    uint64_t occupied = stones[0] | stones[1];
+
+    int child_cells[PNS_MAX_CELLS];
+    uint32_t child_pn[PNS_MAX_CELLS];
+    uint32_t child_dn[PNS_MAX_CELLS];
+    int child_count = 0;
+
+    for (int cell = 0; cell < cell_count; cell++)
+    {
+        if (!(occupied & (1ull << cell)))
+        {
+            child_cells[child_count++] = cell;
+        }
+    }
+
+    uint64_t first_node = solver->nodes++;
+
+    while (1)
+    {
+        // collect the children's numbers and work out our own
+        uint32_t pn = is_or_node ? PNS_INFINITY : 0;
+        uint32_t dn = is_or_node ? 0 : PNS_INFINITY;
+        int best = -1;
+        uint32_t second_best = PNS_INFINITY;
+
+        for (int i = 0; i < child_count; i++)
+        {
+            uint64_t child[2] = {stones[0], stones[1]};
+            child[to_move] |= 1ull << child_cells[i];
+            evaluate_child(solver, child, to_move, child_cells[i], &child_pn[i], &child_dn[i]);
+
+            // the number the player to move wants as small as possible
+            uint32_t target = is_or_node ? child_pn[i] : child_dn[i];
+            if (best == -1 || target < (is_or_node ? child_pn[best] : child_dn[best]))
+            {
+                if (best != -1)
+                {
+                    second_best = is_or_node ? child_pn[best] : child_dn[best];
+                }
+                best = i;
+            }
+            else if (target < second_best)
+            {
+                second_best = target;
+            }
+
+            if (is_or_node)
+            {
+                pn = child_pn[i] < pn ? child_pn[i] : pn;
+                dn = add_numbers(dn, child_dn[i]);
+            }
+            else
+            {
+                pn = add_numbers(pn, child_pn[i]);
+                dn = child_dn[i] < dn ? child_dn[i] : dn;
+            }
+        }
+
+        uint64_t work = solver->nodes - first_node;
+        store(solver, stones, to_move, pn, dn, work > 0xFFFFFFFF ? 0xFFFFFFFF : work);
+
+        if (pn >= pn_threshold || dn >= dn_threshold || solver->nodes >= solver->node_budget)
+        {
+            return;
+        }
+
+        // search the most promising child until it stops being the most
+        // promising one (or would push us over our own thresholds)
+        uint32_t next_pn_threshold, next_dn_threshold;
+        if (is_or_node)
+        {
+            next_pn_threshold = pn_threshold < add_numbers(second_best, 1) ? pn_threshold : add_numbers(second_best, 1);
+            next_dn_threshold = add_numbers(dn_threshold - dn, child_dn[best]);
+        }
+        else
+        {
+            next_dn_threshold = dn_threshold < add_numbers(second_best, 1) ? dn_threshold : add_numbers(second_best, 1);
+            next_pn_threshold = add_numbers(pn_threshold - pn, child_pn[best]);
+        }
+
+        uint64_t child[2] = {stones[0], stones[1]};
+        child[to_move] |= 1ull << child_cells[best];
+        multiple_iterative_deepening(solver, child, !to_move, next_pn_threshold, next_dn_threshold);
+    }
+}
+
+pns_result pns_prove(pns_solver* solver, const uint64_t stones[2], int to_move, int attacker, uint64_t node_budget)
+{
+    /*
+     * Try to prove that <attacker> can force a win from the position
+     * with <to_move> to play, searching at most <node_budget> nodes.
+     * Returns PNS_PROVEN for a forced win, PNS_DISPROVEN if there is
+     * none (the defender can draw or win), and PNS_UNKNOWN if the
+     * budget ran out first.
+     */
+    solver->attacker = attacker;
+    solver->nodes = 0;
+    solver->node_budget = node_budget;
+
+    // the table only holds numbers for the current attacker
+    memset(solver->table, 0, (solver->table_mask + 1) * sizeof(pns_entry));
+
+    uint64_t occupied = stones[0] | stones[1];
+    if (__builtin_popcountll(occupied) == solver->board->cell_count)
+    {
+        return PNS_DISPROVEN;
+    }
+
+    multiple_iterative_deepening(solver, stones, to_move, PNS_INFINITY, PNS_INFINITY);
+
+    uint32_t pn, dn;
+    lookup(solver, stones, to_move, &pn, &dn);
+    if (pn == 0)
+    {
+        return PNS_PROVEN;
+    }
+    else if (dn == 0)
+    {
+        return PNS_DISPROVEN;
+    }
+    return PNS_UNKNOWN;
+}
+
+int run_pns(int width, int height, int k, const char* moves, uint64_t node_budget)
+{
+    /*
+     * Prove the value of the position reached by playing <moves>
+     * (comma separated cells counted from 1, X first) on a
+     * <width> x <height> board with <k> in a row, and print it.
+     * Returns 0 on success, and 1 for bad input.
+     */
+    mnk_board board;
+    if (mnk_board_init(&board, width, height, k) != 0)
+    {
+        printf("Unsupported board %dx%d with k=%d!\n", width, height, k);
+        return 1;
+    }
+
+    uint64_t stones[2] = {0, 0};
+    int to_move = 0;
+    const char* c = moves;
+    while (*c)
+    {
+        char* end;
+        long cell = strtol(c, &end, 10) - 1;
+        if (end == c || cell < 0 || cell >= board.cell_count
+                || ((stones[0] | stones[1]) & (1ull << cell)))
+        {
+            printf("Invalid move sequence %s!\n", moves);
+            return 1;
+        }
+        stones[to_move] |= 1ull << cell;
+        if (mnk_check_win(&board, stones[to_move], cell))
+        {
+            printf("The game is already over!\n");
+            return 1;
+        }
+        to_move = !to_move;
+        c = (*end == ',') ? end + 1 : end;
+    }
+
+    pns_solver* solver = pns_create(&board, PNS_TABLE_BITS);
+    if (solver == NULL)
+    {
+        printf("\n Allocation Failed! Exiting.. \n");
+        exit(1);
+    }
+
+    const char* names[2] = {"X", "O"};
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    TRACE_BEGIN("pns");
+
+    // first the player to move, then the opponent if that fails
+    int winner = -1;
+    int unknown = 0;
+    uint64_t nodes = 0;
+    for (int i = 0; i < 2 && winner == -1 && !unknown; i++)
+    {
+        int attacker = i ? !to_move : to_move;
+        pns_result result = pns_prove(solver, stones, to_move, attacker, node_budget);
+        nodes += pns_get_nodes(solver);
+        if (result == PNS_PROVEN)
+        {
+            winner = attacker;
+        }
+        else if (result == PNS_UNKNOWN)
+        {
+            unknown = 1;
+        }
+    }
+
+    TRACE_END("pns");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+    if (winner != -1)
+    {
+        printf("%s wins", names[winner]);
+    }
+    else if (unknown)
+    {
+        printf("Unknown, the node budget ran out");
+    }
+    else
+    {
+        printf("Draw");
+    }
+    printf(" (%dx%d, k=%d, %llu nodes in %.3f s)\n", width, height, k, (unsigned long long)nodes, seconds);
+
+    pns_destroy(solver);
+    return 0;
+}
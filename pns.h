@@ -0,0 +1,57 @@
+#ifndef PNS_H
+#define PNS_H
+
+#include <stdint.h>
+
+/*
+ * Proof-number search (df-pn) for k-in-a-row on boards of up to 64 cells.
+ *
+ * Players are 0 (X) and 1 (O), as in get_index_from_playable(). Cells are
+ * numbered row by row from 0, and each player's stones are a uint64_t
+ * bitboard with bit <cell> set for every cell they hold.
+ */
+
+#define PNS_MAX_CELLS 64
+// four directions, at most one line starting at each cell per direction
+#define PNS_MAX_LINES (4 * PNS_MAX_CELLS)
+// at most k <= 8 lines through a cell per direction
+#define PNS_MAX_CELL_LINES 32
+
+// run_pns() table size, 2^22 entries of 32 bytes
+#define PNS_TABLE_BITS 22
+
+typedef struct
+{
+    int width;
+    int height;
+    int k;
+    int cell_count;
+
+    // every winning line on the board
+    int line_count;
+    uint64_t line_masks[PNS_MAX_LINES];
+
+    // the lines going through each cell, as indices into line_masks
+    int cell_line_count[PNS_MAX_CELLS];
+    uint8_t cell_lines[PNS_MAX_CELLS][PNS_MAX_CELL_LINES];
+} mnk_board;
+
+typedef enum {
+    PNS_PROVEN,
+    PNS_DISPROVEN,
+    PNS_UNKNOWN
+} pns_result;
+
+typedef struct pns_solver_t pns_solver;
+
+int mnk_board_init(mnk_board* board, int width, int height, int k);
+int mnk_check_win(const mnk_board* board, uint64_t stones, int cell);
+
+pns_solver* pns_create(const mnk_board* board, int table_bits);
+void pns_destroy(pns_solver* solver);
+pns_result pns_prove(pns_solver* solver, const uint64_t stones[2], int to_move, int attacker, uint64_t node_budget);
+uint64_t pns_get_nodes(const pns_solver* solver);
+
+int run_pns(int width, int height, int k, const char* moves, uint64_t node_budget);
+
+#endif
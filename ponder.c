@@ -0,0 +1,114 @@
+/*
+ * PONDERING
+ *
+ * While play_pvc waits for the player's move, a background thread works out
+ * the engine's answer to each reply the player is likely to make, the best
+ * replies (according to analyse_moves) first. Once the player has moved, the
+ * answer is either already there, or the thread is busy searching it and is
+ * left to finish. If the thread is busy with a reply that wasn't played, that
+ * search is abandoned, and the engine searches the real move from scratch.
+ *
+ * The thread is always joined before play_pvc goes on, so the engine never
+ * runs on two threads at once.
+ */
+
+#include <stdio.h>
+#include "ponder.h"
+#include "trace.h"
+
+static void* ponder_worker(void* arg)
+{
+    ponder_state* ponder = arg;
+
+    TRACE_BEGIN("ponder");
+    set_search_abort_flag(&ponder->abort);
+
+    move_analysis analysis[9];
+    int move_count = analyse_moves(ponder->state, ponder->player, analysis);
+
+    pthread_mutex_lock(&ponder->lock);
+    for (int i = 0; i < move_count; i++)
+    {
+        ponder->replies[i] = make_play(ponder->state, ponder->player, analysis[i].move);
+        ponder->answers[i] = 0;
+    }
+    ponder->reply_count = move_count;
+    pthread_mutex_unlock(&ponder->lock);
+
+    for (int i = 0; i < move_count; i++)
+    {
+        // no answer needed once the reply ends the game
+        uint32_t reply = ponder->replies[i];
+        if (check_win(reply, ponder->player) || check_draw(reply))
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&ponder->lock);
+        int stop = ponder->stop;
+        ponder->searching = i;
+        pthread_mutex_unlock(&ponder->lock);
+        if (stop)
+        {
+            break;
+        }
+
+        int answer = compute_move_for_state(reply, false);
+
+        pthread_mutex_lock(&ponder->lock);
+        ponder->searching = -1;
+        if (!atomic_load(&ponder->abort))
+        {
+            ponder->answers[i] = answer;
+        }
+        pthread_mutex_unlock(&ponder->lock);
+    }
+
+    set_search_abort_flag(NULL);
+    TRACE_END("ponder");
+    return NULL;
+}
+
+void ponder_start(ponder_state* ponder, uint32_t state, playables player)
+{
+    // start pondering on the replies of <player> from <state>
+    ponder->state = state;
+    ponder->player = player;
+    ponder->reply_count = 0;
+    ponder->searching = -1;
+    ponder->stop = 0;
+    atomic_init(&ponder->abort, 0);
+    pthread_mutex_init(&ponder->lock, NULL);
+    pthread_create(&ponder->thread, NULL, ponder_worker, ponder);
+}
+
+int ponder_finish(ponder_state* ponder, uint32_t played)
+{
+    /*
+     * Stop pondering now that the player's move has led to <played>.
+     * If the answer to <played> is being searched, the search is left
+     * to finish, any other search is abandoned.
+     * Returns the engine's answer (1-9), or 0 if it wasn't pondered.
+     */
+    pthread_mutex_lock(&ponder->lock);
+    ponder->stop = 1;
+    if (ponder->searching != -1 && ponder->replies[ponder->searching] != played)
+    {
+        atomic_store(&ponder->abort, 1);
+    }
+    pthread_mutex_unlock(&ponder->lock);
+
+    TRACE_BEGIN("ponder_wait");
+    pthread_join(ponder->thread, NULL);
+    TRACE_END("ponder_wait");
+    pthread_mutex_destroy(&ponder->lock);
+
+    for (int i = 0; i < ponder->reply_count; i++)
+    {
+        if (ponder->replies[i] == played)
+        {
+            return ponder->answers[i];
+        }
+    }
+    return 0;
+}
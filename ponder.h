@@ -0,0 +1,38 @@
+#ifndef PONDER_H
+#define PONDER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "pvc.h"
+
+// background search of the engine's answers while the player thinks
+typedef struct
+{
+    pthread_t thread;
+
+    // position with the player to move
+    uint32_t state;
+    playables player;
+
+    // positions after the player's likely replies, most likely first,
+    // and the engine's answer to each one (0 until it has been searched)
+    int reply_count;
+    uint32_t replies[9];
+    int answers[9];
+
+    // reply being searched right now, -1 if none
+    int searching;
+
+    // set once the player has moved, the thread stops before its next search
+    int stop;
+    pthread_mutex_t lock;
+
+    // set when the reply being searched wasn't played, to abandon it
+    atomic_int abort;
+} ponder_state;
+
+void ponder_start(ponder_state* ponder, uint32_t state, playables player);
+int ponder_finish(ponder_state* ponder, uint32_t played);
+
+#endif
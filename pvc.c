@@ -53,7 +53,12 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
 #include "pvc.h"
+#include "trace.h"
+#include "gamelog.h"
+#include "ponder.h"
 
 // constant values
 
@@ -69,10 +74,6 @@ const uint32_t win_bitmasks[2][8] = {
 
 const int all_fill_bitmask = 0x000001FF;
 
-typedef enum {
-    X, O
-} playables;
-
 // one specific state of the game.
 typedef struct node_t
 {
@@ -264,6 +265,88 @@ int heuristic(uint32_t state, playables p)
 }
 
 
+/*
+ * STATIC EVALUATION
+ *
+ * heuristic() can only tell terminal states apart, which is of no use once the
+ * search has to stop before the end of the game. evaluate() scores every line
+ * by counting the stones each side has on it. As the X and O win_bitmasks are
+ * the same lines in different bitboards, the count is a popcount of the state
+ * ANDed with the line mask, so no cell is ever looked at on its own.
+ *
+ * A line with stones from only one side is "open" for that side, a line with
+ * two stones from one side and none from the other is a threat, and two or
+ * more threats at once is a double threat (a fork), which can't be stopped.
+ * A line where a side sits on an opponent's pair is "blocked" and earns the
+ * blocking side a bonus.
+ *
+ * The weights can be changed at runtime to tune the evaluation.
+ */
+
+int eval_weights[EVAL_WEIGHT_COUNT] = {
+    1,      // EVAL_OPEN_ONE
+    8,      // EVAL_OPEN_TWO
+    64,     // EVAL_DOUBLE_THREAT
+    4,      // EVAL_BLOCKED
+    1000    // EVAL_WIN
+};
+
+int evaluate(uint32_t state, playables p)
+{
+    /*
+     * Static Evaluation for the Game Board
+     * Returns a score for the state from the point of view of <p>,
+     * positive if the state favours <p> and negative if it doesn't.
+     * Won and lost states score +/- eval_weights[EVAL_WIN].
+     */
+    int line_score[2] = {0, 0};
+    int threats[2] = {0, 0};
+
+    for (int i = 0; i < 8; i++)
+    {
+        int x_count = __builtin_popcount(state & win_bitmasks[0][i]);
+        int o_count = __builtin_popcount(state & win_bitmasks[1][i]);
+
+        if (x_count == 3 || o_count == 3)
+        {
+            int sign = (x_count == 3) ? 1 : -1;
+            int win_score = sign * eval_weights[EVAL_WIN];
+            return (p == X) ? win_score : -win_score;
+        }
+
+        if (o_count == 0 && x_count > 0)
+        {
+            line_score[0] += eval_weights[x_count == 1 ? EVAL_OPEN_ONE : EVAL_OPEN_TWO];
+            threats[0] += (x_count == 2);
+        }
+        else if (x_count == 0 && o_count > 0)
+        {
+            line_score[1] += eval_weights[o_count == 1 ? EVAL_OPEN_ONE : EVAL_OPEN_TWO];
+            threats[1] += (o_count == 2);
+        }
+        else if (x_count == 1 && o_count == 2)
+        {
+            line_score[0] += eval_weights[EVAL_BLOCKED];
+        }
+        else if (o_count == 1 && x_count == 2)
+        {
+            line_score[1] += eval_weights[EVAL_BLOCKED];
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (threats[i] >= 2)
+        {
+            line_score[i] += eval_weights[EVAL_DOUBLE_THREAT];
+        }
+    }
+
+    int score = line_score[0] - line_score[1];
+    return (p == X) ? score : -score;
+}
+
+
 int get_state(uint32_t state, playables player, int position)
 {
     /*
@@ -403,6 +486,22 @@ void print_node(node* origin)
 }
 
 
+// flag a thread can raise to abandon its current search, once it is set
+// generate_moves stops growing the tree and the result is meaningless
+_Thread_local atomic_int* search_abort_flag = NULL;
+
+void set_search_abort_flag(atomic_int* flag)
+{
+    search_abort_flag = flag;
+}
+
+// checked by every search as it goes, so an abandoned search
+// returns as soon as possible
+int search_aborted()
+{
+    return search_abort_flag != NULL && atomic_load_explicit(search_abort_flag, memory_order_relaxed);
+}
+
 node** generate_moves(node* origin, int depth)
 {
     /*
@@ -421,6 +520,11 @@ node** generate_moves(node* origin, int depth)
     // and do nothing
     int status = heuristic(origin->state, origin->current_playable);
 
+    if (search_aborted())
+    {
+        return NULL;
+    }
+
     int current_children_count = 0;
 
     // declare the next pointer array
@@ -598,10 +702,24 @@ int run_minimax(node* origin)
 }
 
 
-int generate_move_for_state(uint32_t state)
+int compute_move_for_state(uint32_t state, bool verbose)
 {
     // function to allocate and generate game tree for a specific game
-    // state
+    // state, <verbose> prints the search as it goes
+
+    // the hybrid engine replaces the game tree when it's switched on
+    if (hybrid_exact_below >= 0)
+    {
+        TRACE_BEGIN("hybrid_move");
+        int move = hybrid_move_for_state(state, X, hybrid_exact_below, hybrid_search_depth);
+        TRACE_END("hybrid_move");
+        if (verbose)
+        {
+            printf("Winning Move at %d\n", move);
+        }
+        return move;
+    }
+
     node* origin = malloc(sizeof(node));
 
     // use this constant pointer to free the game state
@@ -618,20 +736,458 @@ int generate_move_for_state(uint32_t state)
     origin->move_index = 0;
     origin->children_count = 0;
 
-    printf("Generating Game Tree For >> \n");
-    print_node(origin);
+    if (verbose)
+    {
+        printf("Generating Game Tree For >> \n");
+        print_node(origin);
+    }
+    TRACE_BEGIN("generate_moves");
     node** testbed = generate_moves(origin, 8);
     origin->future_states = testbed;
+    TRACE_END("generate_moves");
 
-    // run while we still have access to game tree
-    int wm_index = run_minimax(origin);
-    printf("Winning Move at %d\n", wm_index);
+    // run while we still have access to game tree, unless the
+    // search was abandoned and the tree is incomplete
+    int wm_index = 0;
+    if (!search_aborted())
+    {
+        TRACE_BEGIN("run_minimax");
+        wm_index = run_minimax(origin);
+        TRACE_END("run_minimax");
+    }
+    if (verbose)
+    {
+        printf("Winning Move at %d\n", wm_index);
+    }
 
     // free the game tree
+    TRACE_BEGIN("free_game_tree");
     free_game_tree(origin);
+    TRACE_END("free_game_tree");
     return wm_index;
 }
 
+int generate_move_for_state(uint32_t state)
+{
+    return compute_move_for_state(state, true);
+}
+
+
+// depth-limited negamax search with alpha-beta pruning, returns
+// the score of the state for <p>, the player to move.
+// the search stops after <depth> plies and scores the horizon
+// with evaluate(), so nothing is allocated along the way.
+// when a network is loaded <acc> is its accumulator for <state>,
+// kept up to date move by move, and it scores the horizon instead.
+int search_position(uint32_t state, playables p, int depth, int alpha, int beta, const nnue_accumulator* acc)
+{
+    playables anti_player = get_next_playable(p);
+
+    // a win found with more depth remaining is a faster win,
+    // so it is worth more than a slower one
+    if (check_win(state, anti_player))
+    {
+        return -(eval_weights[EVAL_WIN] + depth);
+    }
+    else if (check_draw(state))
+    {
+        return 0;
+    }
+    else if (depth <= 0)
+    {
+        if (acc != NULL)
+        {
+            return nnue_evaluate(acc, get_index_from_playable(p), eval_weights[EVAL_WIN] - 1);
+        }
+        return evaluate(state, p);
+    }
+
+    for (int i = 0; i < 9; i++)
+    {
+        // the score doesn't matter any more once the search is abandoned
+        if (search_aborted())
+        {
+            break;
+        }
+
+        // make_play only rejects cells taken by the other player
+        if (check_index(state, i+1))
+        {
+            continue;
+        }
+        uint32_t played = make_play(state, p, i+1);
+
+        nnue_accumulator child_acc;
+        if (acc != NULL)
+        {
+            nnue_add_move(acc, &child_acc, get_index_from_playable(p), i+1);
+        }
+
+        int score = -search_position(played, anti_player, depth-1, -beta, -alpha, acc != NULL ? &child_acc : NULL);
+        if (score > alpha)
+        {
+            alpha = score;
+        }
+        if (alpha >= beta)
+        {
+            break;
+        }
+    }
+    return alpha;
+}
+
+// function to pick the best move (1-9) for <p> with a depth-limited
+// search, returns -1 if there is no move to be made
+int search_move_depth_limited(uint32_t state, playables p, int depth)
+{
+    int best_move = -1;
+    int best_score = -100000;
+
+    // the network's accumulator, if there is one, is only built
+    // from scratch here and updated incrementally from then on
+    nnue_accumulator acc;
+    if (nnue_active_network != NULL)
+    {
+        nnue_refresh(&acc, state);
+    }
+
+    for (int i = 0; i < 9; i++)
+    {
+        // make_play only rejects cells taken by the other player
+        if (check_index(state, i+1))
+        {
+            continue;
+        }
+        uint32_t played = make_play(state, p, i+1);
+
+        nnue_accumulator child_acc;
+        if (nnue_active_network != NULL)
+        {
+            nnue_add_move(&acc, &child_acc, get_index_from_playable(p), i+1);
+        }
+
+        int score = -search_position(played, get_next_playable(p), depth-1, -100000, -best_score,
+                nnue_active_network != NULL ? &child_acc : NULL);
+        if (best_move == -1 || score > best_score)
+        {
+            best_score = score;
+            best_move = i+1;
+        }
+    }
+    return best_move;
+}
+
+
+/*
+ * EXACT SOLVER
+ *
+ * solve_position() searches to the end of the game and returns the exact
+ * value of the state for the player to move. The value carries the distance
+ * to the result, so a faster win (or a slower loss) scores higher:
+ *
+ *   win in d plies  ->  SOLVE_WIN - d
+ *   draw            ->  0
+ *   loss in d plies -> -(SOLVE_WIN - d)
+ *
+ * Every solved state is kept in solve_cache, indexed by the player to move
+ * and the two 9-bit bitboards (2 * 2^18 entries of one byte). An entry holds
+ * the score offset by SOLVE_WIN + 1, so that 0 can mean "not solved yet".
+ * The cache never needs to be cleared, as the value of a state never changes.
+ *
+ * Solving the empty board once fills in every state reachable from it, after
+ * which solve_position() only reads the cache and is safe to call from
+ * several threads.
+ */
+
+uint8_t solve_cache[1 << 19];
+
+int get_solve_cache_index(uint32_t state, playables p)
+{
+    uint32_t x_board = (state >> 12) & 0x000001FF;
+    uint32_t o_board = state & 0x000001FF;
+    return (get_index_from_playable(p) << 18) | (x_board << 9) | o_board;
+}
+
+// score of the move that led to <played> for the player who made it,
+// which is the negated score of the state one ply further from the result
+int solve_move(uint32_t played, playables next)
+{
+    int child_score = solve_position(played, next);
+    int score = -child_score;
+    if (child_score > 0)
+    {
+        score++;
+    }
+    else if (child_score < 0)
+    {
+        score--;
+    }
+    return score;
+}
+
+int solve_position(uint32_t state, playables p)
+{
+    playables anti_player = get_next_playable(p);
+
+    // the previous move won the game
+    if (check_win(state, anti_player))
+    {
+        return -SOLVE_WIN;
+    }
+    else if (check_draw(state))
+    {
+        return 0;
+    }
+
+    int cache_index = get_solve_cache_index(state, p);
+    if (solve_cache[cache_index])
+    {
+        return solve_cache[cache_index] - SOLVE_WIN - 1;
+    }
+
+    int best_score = -SOLVE_WIN - 1;
+    for (int i = 0; i < 9; i++)
+    {
+        if (search_aborted())
+        {
+            break;
+        }
+        if (check_index(state, i+1))
+        {
+            continue;
+        }
+        uint32_t played = make_play(state, p, i+1);
+        int score = solve_move(played, anti_player);
+
+        if (score > best_score)
+        {
+            best_score = score;
+        }
+    }
+
+    // an abandoned solve may have skipped moves, so its score
+    // is meaningless and must not end up in the cache
+    if (search_aborted())
+    {
+        return 0;
+    }
+
+    solve_cache[cache_index] = best_score + SOLVE_WIN + 1;
+    return best_score;
+}
+
+
+/*
+ * MULTI-PV ANALYSIS
+ *
+ * analyse_moves() scores every legal move from a state in one pass. Sibling
+ * moves often lead to the same states further down (the same moves played in
+ * a different order), and those are only solved once thanks to solve_cache.
+ */
+
+int analyse_moves(uint32_t state, playables p, move_analysis analysis[9])
+{
+    /*
+     * Fill <analysis> with the exact score and distance to the result of
+     * every legal move for <p>, best move first.
+     * Returns the number of legal moves, 0 if the game is already over.
+     */
+    if (check_win(state, X) || check_win(state, O) || check_draw(state))
+    {
+        return 0;
+    }
+
+    // a drawn game only ends when the board is full
+    int empty_count = 9 - __builtin_popcount(state & 0x001FF1FF);
+    int move_count = 0;
+
+    for (int i = 0; i < 9; i++)
+    {
+        if (check_index(state, i+1))
+        {
+            continue;
+        }
+        uint32_t played = make_play(state, p, i+1);
+        int score = solve_move(played, get_next_playable(p));
+
+        move_analysis entry;
+        entry.move = i+1;
+        entry.score = score;
+        entry.distance = (score == 0) ? empty_count : SOLVE_WIN - abs(score);
+
+        // insertion sort, best score first and board order among equals
+        int j = move_count;
+        while (j > 0 && analysis[j-1].score < score)
+        {
+            analysis[j] = analysis[j-1];
+            j--;
+        }
+        analysis[j] = entry;
+        move_count++;
+    }
+    return move_count;
+}
+
+/*
+ * HYBRID ENGINE
+ *
+ * Early in the game the tree is too big to search to the end, so the hybrid
+ * engine uses the depth-limited search (search_move_depth_limited). Once fewer
+ * than <exact_below> cells are empty, what is left of the tree is small enough
+ * to solve exactly, and the best move comes from analyse_moves. Neither part
+ * allocates, and the exact part fills solve_cache as it goes, so every
+ * endgame state is only ever solved once.
+ */
+
+// when hybrid_exact_below is -1 play_pvc uses the full game tree instead
+int hybrid_exact_below = -1;
+int hybrid_search_depth = 4;
+
+void set_pvc_hybrid_engine(int exact_below, int search_depth)
+{
+    hybrid_exact_below = exact_below;
+    hybrid_search_depth = search_depth;
+}
+
+int hybrid_move_for_state(uint32_t state, playables p, int exact_below, int search_depth)
+{
+    // returns the move (1-9) for <p>, or -1 if there is none
+    int empty_count = 9 - __builtin_popcount(state & 0x001FF1FF);
+
+    if (empty_count < exact_below)
+    {
+        move_analysis analysis[9];
+        if (analyse_moves(state, p, analysis) == 0)
+        {
+            return -1;
+        }
+        return analysis[0].move;
+    }
+    return search_move_depth_limited(state, p, search_depth);
+}
+
+
+/*
+ * PERFT
+ *
+ * perft() counts the leaves of the game tree down to <depth> plies, where a
+ * finished game counts as a leaf wherever it ends. It only uses make_play and
+ * heuristic, so it measures (and checks) move generation and terminal
+ * detection on their own, without any search or tree allocation.
+ *
+ * One ply above the horizon the children are counted in bulk from the number
+ * of empty cells, as every one of them is a leaf whether it ends the game or
+ * not.
+ */
+
+// perft() totals from the empty board with X to move, for depths 1-9
+const uint64_t perft_reference[9] = {9, 72, 504, 3024, 15120, 56160, 154944, 255168, 255168};
+
+uint64_t perft(uint32_t state, playables p, int depth)
+{
+    if (heuristic(state, p) != 2 || depth <= 0)
+    {
+        return 1;
+    }
+    if (depth == 1)
+    {
+        return 9 - __builtin_popcount(state & 0x001FF1FF);
+    }
+
+    uint64_t nodes = 0;
+    for (int i = 0; i < 9; i++)
+    {
+        if (check_index(state, i+1))
+        {
+            continue;
+        }
+        nodes += perft(make_play(state, p, i+1), get_next_playable(p), depth-1);
+    }
+    return nodes;
+}
+
+int run_perft(int depth, const char* moves, int split)
+{
+    /*
+     * Run perft to <depth> from the position reached by playing
+     * <moves> (positions 1-9, X first), and print the node count
+     * and nodes per second. With <split>, also print the count
+     * under every root move.
+     * Returns 0 on success, and 1 for a bad position or a count
+     * that doesn't match the reference.
+     */
+    uint32_t state = 0;
+    playables current = X;
+
+    for (const char* c = moves; *c; c++)
+    {
+        int position = *c - '0';
+        if (position < 1 || position > 9 || check_index(state, position)
+                || heuristic(state, current) != 2)
+        {
+            printf("Invalid move sequence %s!\n", moves);
+            return 1;
+        }
+        state = make_play(state, current, position);
+        current = get_next_playable(current);
+    }
+
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    TRACE_BEGIN("perft");
+
+    uint64_t nodes = 0;
+    if (split && depth > 0 && heuristic(state, current) == 2)
+    {
+        for (int i = 0; i < 9; i++)
+        {
+            if (check_index(state, i+1))
+            {
+                continue;
+            }
+            uint64_t move_nodes = perft(make_play(state, current, i+1), get_next_playable(current), depth-1);
+            printf("%d: %llu\n", i+1, (unsigned long long)move_nodes);
+            nodes += move_nodes;
+        }
+    }
+    else
+    {
+        nodes = perft(state, current, depth);
+    }
+
+    TRACE_END("perft");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+    printf(
+            "perft(%d) = %llu nodes in %.6f s (%.0f nodes/s)\n",
+            depth,
+            (unsigned long long)nodes,
+            seconds,
+            seconds > 0 ? nodes / seconds : 0.0
+          );
+
+    // check against the known totals from the empty board
+    if (state == 0 && depth >= 1)
+    {
+        uint64_t expected = perft_reference[(depth > 9 ? 9 : depth) - 1];
+        if (nodes != expected)
+        {
+            printf("MISMATCH: expected %llu\n", (unsigned long long)expected);
+            return 1;
+        }
+        printf("OK\n");
+    }
+    return 0;
+}
+
+// log every finished play_pvc game is appended to, if set
+gamelog_writer* pvc_game_log = NULL;
+
+void set_pvc_game_log(gamelog_writer* log)
+{
+    pvc_game_log = log;
+}
 
 void play_pvc()
 {
@@ -645,6 +1201,16 @@ void play_pvc()
     int lead_choice = 0;
     int turn = 0;
 
+    // moves played so far and the outcome, for the game log
+    uint8_t moves[9];
+    int move_count = 0;
+    uint8_t result = GAMELOG_UNFINISHED;
+
+    // the engine searches the likely replies while the player thinks,
+    // <pondered_move> is its answer to the move actually played, if any
+    ponder_state ponder;
+    int pondered_move = 0;
+
     // printf("%d\n", check_draw(0x0017208D));
 
     playables seq_array[2];
@@ -680,14 +1246,28 @@ void play_pvc()
         char* playable_string = get_string_for_playable(current);
         printf("Player Turn : %s\n", playable_string);
 
+        TRACE_BEGIN("output");
         printf("The board is currently >> \n");
         print_board(state);
+        TRACE_END("output");
 
         // set X to be the first player, computer
         if (current == X)
         {
             // generate the move
-            int play_pos = generate_move_for_state(state);
+            TRACE_BEGIN("engine_move");
+            int play_pos;
+            if (pondered_move > 0)
+            {
+                play_pos = pondered_move;
+                pondered_move = 0;
+                printf("Winning Move at %d (pondered)\n", play_pos);
+            }
+            else
+            {
+                play_pos = generate_move_for_state(state);
+            }
+            TRACE_END("engine_move");
             state = make_play(state,  current, play_pos);
             if (state == -1)
             {
@@ -695,20 +1275,35 @@ void play_pvc()
                 flag = 1;
                 break;
             }
+            if (move_count < 9)
+            {
+                moves[move_count++] = play_pos;
+            }
         }
         else
         {
             int play_pos;
+            ponder_start(&ponder, state, current);
+
+            TRACE_BEGIN("input");
             printf("Enter the position to play at (1-9) >> ");
             scanf("%d", &play_pos);
+            TRACE_END("input");
 
-            state = make_play(state,  current, play_pos);
+            uint32_t played = make_play(state, current, play_pos);
+            pondered_move = ponder_finish(&ponder, played);
+
+            state = played;
             if (state == -1)
             {
                 printf("Invalid Move!\n");
                 flag = 1;
                 break;
             }
+            if (move_count < 9)
+            {
+                moves[move_count++] = play_pos;
+            }
         }
 
         int winstatus = heuristic(state, current);
@@ -718,18 +1313,21 @@ void play_pvc()
             case 1:
                 print_board(state);
                 printf("Player Wins!\n");
+                result = (current == X) ? GAMELOG_X_WINS : GAMELOG_O_WINS;
                 flag = 1;
                 break;
 
             case -1:
                 print_board(state);
                 printf("Player Loses!\n");
+                result = (current == X) ? GAMELOG_O_WINS : GAMELOG_X_WINS;
                 flag = 1;
                 break;
 
             case 0:
                 print_board(state);
                 printf("Draw!\n");
+                result = GAMELOG_DRAW;
                 flag = 1;
                 break;
         }
@@ -737,6 +1335,17 @@ void play_pvc()
 
     }
 
+    if (pvc_game_log != NULL && (lead_choice == 1 || lead_choice == 2))
+    {
+        if (lead_choice == 2)
+        {
+            result |= GAMELOG_O_FIRST;
+        }
+        TRACE_BEGIN("game_log");
+        gamelog_append(pvc_game_log, moves, move_count, result);
+        TRACE_END("game_log");
+    }
+
     // free_game_tree(origin);
     printf("Free Complete!\n");
 
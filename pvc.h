@@ -1,2 +1,73 @@
+#ifndef PVC_H
+#define PVC_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "gamelog.h"
+#include "nnue.h"
+
+typedef enum {
+    X, O
+} playables;
+
+// indices into the eval_weights table used by evaluate()
+typedef enum {
+    EVAL_OPEN_ONE,
+    EVAL_OPEN_TWO,
+    EVAL_DOUBLE_THREAT,
+    EVAL_BLOCKED,
+    EVAL_WIN,
+    EVAL_WEIGHT_COUNT
+} eval_weight_index;
+
+// score of a win found by solve_position() on the move, a win in
+// d plies scores SOLVE_WIN - d and a loss in d plies -(SOLVE_WIN - d)
+#define SOLVE_WIN 10
+
+// one root move scored by analyse_moves()
+typedef struct
+{
+    // position played, 1-9
+    int move;
+
+    // solve_position() style score for the player making the move
+    int score;
+
+    // plies from the analysed state until the game is decided
+    int distance;
+} move_analysis;
+
+extern const uint32_t state_bitmasks[2][9];
+extern const uint32_t win_bitmasks[2][8];
+extern int eval_weights[EVAL_WEIGHT_COUNT];
+extern int hybrid_exact_below;
+extern int hybrid_search_depth;
+
+int get_index_from_playable(playables p);
+playables get_next_playable(playables p);
+char* get_string_for_playable(playables p);
+int check_win(uint32_t state, playables p);
+int check_draw(uint32_t state);
+int heuristic(uint32_t state, playables p);
+int check_index(uint32_t state, int position);
+uint32_t make_play(uint32_t state, playables playable, int position);
+void print_board(uint32_t state);
+
+int evaluate(uint32_t state, playables p);
+int search_position(uint32_t state, playables p, int depth, int alpha, int beta, const nnue_accumulator* acc);
+int search_move_depth_limited(uint32_t state, playables p, int depth);
+int solve_position(uint32_t state, playables p);
+int analyse_moves(uint32_t state, playables p, move_analysis analysis[9]);
+int hybrid_move_for_state(uint32_t state, playables p, int exact_below, int search_depth);
+uint64_t perft(uint32_t state, playables p, int depth);
+int run_perft(int depth, const char* moves, int split);
+int compute_move_for_state(uint32_t state, bool verbose);
+void set_search_abort_flag(atomic_int* flag);
+int search_aborted();
+
+void set_pvc_game_log(gamelog_writer* log);
+void set_pvc_hybrid_engine(int exact_below, int search_depth);
 void play_pvc();
+
+#endif
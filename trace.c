@@ -0,0 +1,159 @@
+/*
+ * TIMELINE TRACING
+ *
+ * Every thread that records an event gets its own ring buffer, so recording
+ * never takes a lock. The buffer is allocated and linked into the global list
+ * of buffers the first time the thread records anything; this is the only
+ * point where the mutex is used.
+ *
+ * When a ring fills up the oldest events are overwritten, which keeps the
+ * memory used by a long session bounded. trace_dump() writes whatever is left
+ * in every ring, oldest first, as Chrome trace-event JSON.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+
+// number of events kept per thread, must be a power of two
+#define TRACE_RING_SIZE 65536
+
+typedef struct
+{
+    const char* name;
+    uint64_t timestamp;
+    char phase;
+} trace_event;
+
+typedef struct trace_buffer_t
+{
+    trace_event events[TRACE_RING_SIZE];
+
+    // total number of events ever recorded, the ring index is
+    // this value masked with TRACE_RING_SIZE - 1
+    uint64_t count;
+
+    int thread_id;
+
+    struct trace_buffer_t* next;
+} trace_buffer;
+
+int trace_enabled = 0;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_buffer* trace_buffers = NULL;
+static int trace_thread_count = 0;
+
+static _Thread_local trace_buffer* local_buffer = NULL;
+
+static uint64_t trace_now()
+{
+    // monotonic time in nanoseconds
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static trace_buffer* get_local_buffer()
+{
+    if (local_buffer == NULL)
+    {
+        trace_buffer* buffer = malloc(sizeof(trace_buffer));
+        if (buffer == NULL)
+        {
+            // tracing is best effort, drop the event
+            return NULL;
+        }
+        buffer->count = 0;
+
+        pthread_mutex_lock(&trace_lock);
+        buffer->thread_id = ++trace_thread_count;
+        buffer->next = trace_buffers;
+        trace_buffers = buffer;
+        pthread_mutex_unlock(&trace_lock);
+
+        local_buffer = buffer;
+    }
+    return local_buffer;
+}
+
+static void trace_record(const char* name, char phase)
+{
+    trace_buffer* buffer = get_local_buffer();
+    if (buffer == NULL)
+    {
+        return;
+    }
+    trace_event* event = &buffer->events[buffer->count & (TRACE_RING_SIZE - 1)];
+    event->name = name;
+    event->timestamp = trace_now();
+    event->phase = phase;
+    buffer->count++;
+}
+
+void trace_enable()
+{
+    trace_enabled = 1;
+}
+
+void trace_begin(const char* name)
+{
+    trace_record(name, 'B');
+}
+
+void trace_end(const char* name)
+{
+    trace_record(name, 'E');
+}
+
+int trace_dump(const char* path)
+{
+    /*
+     * Write every recorded event to <path> as Chrome trace-event JSON.
+     * Should be called once the traced threads are done.
+     * Returns 0 on success and -1 if the file couldn't be written.
+     */
+    FILE* out = fopen(path, "w");
+    if (out == NULL)
+    {
+        printf("Could not open %s for the trace!\n", path);
+        return -1;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    int first = 1;
+    pthread_mutex_lock(&trace_lock);
+    for (trace_buffer* buffer = trace_buffers; buffer != NULL; buffer = buffer->next)
+    {
+        uint64_t start = 0;
+        if (buffer->count > TRACE_RING_SIZE)
+        {
+            start = buffer->count - TRACE_RING_SIZE;
+        }
+
+        for (uint64_t i = start; i < buffer->count; i++)
+        {
+            trace_event* event = &buffer->events[i & (TRACE_RING_SIZE - 1)];
+            // trace-event timestamps are in microseconds
+            fprintf(
+                    out,
+                    "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":1,\"tid\":%d}",
+                    first ? "" : ",",
+                    event->name,
+                    event->phase,
+                    (unsigned long long)(event->timestamp / 1000),
+                    (unsigned long long)(event->timestamp % 1000),
+                    buffer->thread_id
+                   );
+            first = 0;
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0 ? 0 : -1;
+}
@@ -0,0 +1,26 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Optional timeline tracing.
+ *
+ * Spans are recorded as timestamped begin/end events into a ring buffer
+ * owned by the calling thread, and can be dumped as Chrome trace-event
+ * JSON (open it in chrome://tracing or ui.perfetto.dev).
+ *
+ * Tracing is off unless trace_enable() has been called, in which case the
+ * TRACE_BEGIN/TRACE_END macros cost a single branch.
+ */
+
+extern int trace_enabled;
+
+void trace_enable();
+void trace_begin(const char* name);
+void trace_end(const char* name);
+int trace_dump(const char* path);
+
+// span names must be string literals (or otherwise outlive the dump)
+#define TRACE_BEGIN(name) do { if (trace_enabled) trace_begin(name); } while (0)
+#define TRACE_END(name) do { if (trace_enabled) trace_end(name); } while (0)
+
+#endif